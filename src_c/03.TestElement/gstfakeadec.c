@@ -40,17 +40,82 @@ GST_STATIC_PAD_TEMPLATE ("src",
 GST_DEBUG_CATEGORY_STATIC (fakeadec_debug);
 #define GST_CAT_DEFAULT fakeadec_debug
 
+#define DEFAULT_QUERY_FAST_PATH TRUE
+
+enum
+{
+  PROP_0,
+  PROP_QUERY_FAST_PATH
+};
+
+/* media types of the sink template, keyed by structure name */
+static GHashTable *sink_media_types;
+
+static void gst_fakeadec_finalize (GObject * object);
+static void gst_fakeadec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_fakeadec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+
 static GstFlowReturn gst_fakeadec_chain (GstPad * pad, GstObject * parent,
     GstBuffer * buffer);
+static gboolean gst_fakeadec_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
 
 #define gst_fakeadec_parent_class parent_class
 G_DEFINE_TYPE (GstFakeAdec, gst_fakeadec, GST_TYPE_ELEMENT);
 
+/* The table can only stand in for intersecting with the template while
+ * every template structure is a bare media type in system memory. If
+ * FD_AUDIO_CAPS ever grows fields or features, leave sink_media_types NULL
+ * so all queries go to the default handler. */
+static void
+gst_fakeadec_init_media_types (void)
+{
+  GstCaps *caps;
+  guint i;
+
+  caps = gst_static_pad_template_get_caps (&gst_fakeadec_sink_pad_template);
+
+  sink_media_types = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      NULL);
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    GstStructure *s = gst_caps_get_structure (caps, i);
+    GstCapsFeatures *f = gst_caps_get_features (caps, i);
+
+    if (gst_structure_n_fields (s) != 0 || (f != NULL
+            && !gst_caps_features_is_equal (f,
+                GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY))) {
+      GST_WARNING ("sink template structure %" GST_PTR_FORMAT " is not a "
+          "bare media type, disabling the query fast path", s);
+      g_hash_table_unref (sink_media_types);
+      sink_media_types = NULL;
+      break;
+    }
+
+    g_hash_table_add (sink_media_types, g_strdup (gst_structure_get_name (s)));
+  }
+
+  gst_caps_unref (caps);
+}
+
 static void
 gst_fakeadec_class_init (GstFakeAdecClass * klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
   GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
 
+  gobject_class->finalize = gst_fakeadec_finalize;
+  gobject_class->set_property = gst_fakeadec_set_property;
+  gobject_class->get_property = gst_fakeadec_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_QUERY_FAST_PATH,
+      g_param_spec_boolean ("query-fast-path", "Query fast path",
+          "Answer sink ACCEPT_CAPS and CAPS queries from the media type "
+          "table instead of the default handler",
+          DEFAULT_QUERY_FAST_PATH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&gst_fakeadec_src_pad_template));
   gst_element_class_add_pad_template (element_class,
@@ -61,6 +126,8 @@ gst_fakeadec_class_init (GstFakeAdecClass * klass)
       "Pass data to backend decoder", "HoonHee Lee <hoonhee.lee@lge.com>");
 
   GST_DEBUG_CATEGORY_INIT (fakeadec_debug, "fakeadec", 0, "Fake audio decoder");
+
+  gst_fakeadec_init_media_types ();
 }
 
 static void
@@ -71,11 +138,234 @@ gst_fakeadec_init (GstFakeAdec * fakeadec)
       "sink");
   gst_pad_set_chain_function (fakeadec->sinkpad,
       GST_DEBUG_FUNCPTR (gst_fakeadec_chain));
+  gst_pad_set_query_function (fakeadec->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_fakeadec_sink_query));
   gst_element_add_pad (GST_ELEMENT (fakeadec), fakeadec->sinkpad);
 
   fakeadec->srcpad =
       gst_pad_new_from_static_template (&gst_fakeadec_src_pad_template, "src");
   gst_element_add_pad (GST_ELEMENT (fakeadec), fakeadec->srcpad);
+
+  fakeadec->query_fast_path = DEFAULT_QUERY_FAST_PATH;
+}
+
+static void
+gst_fakeadec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstFakeAdec *fakeadec = GST_FAKEADEC (object);
+
+  switch (prop_id) {
+    case PROP_QUERY_FAST_PATH:
+      GST_OBJECT_LOCK (fakeadec);
+      fakeadec->query_fast_path = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (fakeadec);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_fakeadec_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstFakeAdec *fakeadec = GST_FAKEADEC (object);
+
+  switch (prop_id) {
+    case PROP_QUERY_FAST_PATH:
+      GST_OBJECT_LOCK (fakeadec);
+      g_value_set_boolean (value, fakeadec->query_fast_path);
+      GST_OBJECT_UNLOCK (fakeadec);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_fakeadec_clear_cache (GstFakeAdecCapsCacheEntry * cache)
+{
+  guint i;
+
+  for (i = 0; i < GST_FAKEADEC_CAPS_CACHE_SIZE; i++) {
+    gst_caps_replace (&cache[i].caps, NULL);
+    gst_caps_replace (&cache[i].result, NULL);
+  }
+}
+
+static void
+gst_fakeadec_finalize (GObject * object)
+{
+  GstFakeAdec *fakeadec = GST_FAKEADEC (object);
+
+  gst_fakeadec_clear_cache (fakeadec->query_caps_cache);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+/* Keys are private copies, so the caller's caps stay writable and are
+ * matched by content. */
+static GstFakeAdecCapsCacheEntry *
+gst_fakeadec_cache_lookup (GstFakeAdecCapsCacheEntry * cache, GstCaps * caps)
+{
+  guint i;
+
+  for (i = 0; i < GST_FAKEADEC_CAPS_CACHE_SIZE; i++) {
+    if (cache[i].caps != NULL && gst_caps_is_strictly_equal (cache[i].caps,
+            caps))
+      return &cache[i];
+  }
+
+  return NULL;
+}
+
+static void
+gst_fakeadec_cache_store (GstFakeAdecCapsCacheEntry * cache, guint * next,
+    GstCaps * caps, GstCaps * result)
+{
+  GstFakeAdecCapsCacheEntry *entry = &cache[*next];
+
+  if (entry->caps != NULL)
+    gst_caps_unref (entry->caps);
+  entry->caps = gst_caps_copy (caps);
+  gst_caps_replace (&entry->result, result);
+
+  *next = (*next + 1) % GST_FAKEADEC_CAPS_CACHE_SIZE;
+}
+
+/* Every sink template structure is a bare media type in system memory, so
+ * caps are a subset of the template exactly when each of their structures
+ * has one of those names and system memory features. */
+static gboolean
+gst_fakeadec_structure_is_accepted (GstCaps * caps, guint idx)
+{
+  GstStructure *s = gst_caps_get_structure (caps, idx);
+  GstCapsFeatures *f = gst_caps_get_features (caps, idx);
+
+  if (f != NULL && !gst_caps_features_is_equal (f,
+          GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY))
+    return FALSE;
+
+  return g_hash_table_contains (sink_media_types, gst_structure_get_name (s));
+}
+
+/* Answered straight from the table: one hash lookup per structure is
+ * cheaper than copying the caps for a cache key. */
+static gboolean
+gst_fakeadec_accept_caps (GstFakeAdec * fakeadec, GstCaps * caps)
+{
+  gboolean accepted = TRUE;
+  guint i;
+
+  if (gst_caps_is_any (caps)) {
+    accepted = FALSE;
+  } else {
+    for (i = 0; i < gst_caps_get_size (caps) && accepted; i++)
+      accepted = gst_fakeadec_structure_is_accepted (caps, i);
+  }
+
+  GST_LOG_OBJECT (fakeadec, "caps %" GST_PTR_FORMAT " accepted: %d", caps,
+      accepted);
+
+  return accepted;
+}
+
+/* Same result as intersecting @filter with the sink template caps in
+ * GST_CAPS_INTERSECT_FIRST mode. Returns NULL for filters the lookup table
+ * can't answer, which are left to the default handler. */
+static GstCaps *
+gst_fakeadec_query_caps (GstFakeAdec * fakeadec, GstCaps * filter)
+{
+  GstFakeAdecCapsCacheEntry *entry;
+  GstCaps *result;
+  guint i;
+
+  if (gst_caps_is_any (filter))
+    return NULL;
+
+  GST_OBJECT_LOCK (fakeadec);
+  entry = gst_fakeadec_cache_lookup (fakeadec->query_caps_cache, filter);
+  if (entry != NULL) {
+    result = gst_caps_ref (entry->result);
+    GST_OBJECT_UNLOCK (fakeadec);
+    return result;
+  }
+  GST_OBJECT_UNLOCK (fakeadec);
+
+  result = gst_caps_new_empty ();
+  for (i = 0; i < gst_caps_get_size (filter); i++) {
+    GstCapsFeatures *f = gst_caps_get_features (filter, i);
+
+    if (f != NULL && gst_caps_features_is_any (f)) {
+      gst_caps_unref (result);
+      return NULL;
+    }
+
+    if (!gst_fakeadec_structure_is_accepted (filter, i))
+      continue;
+
+    result = gst_caps_merge_structure_full (result,
+        gst_structure_copy (gst_caps_get_structure (filter, i)),
+        f ? gst_caps_features_copy (f) : NULL);
+  }
+
+  GST_LOG_OBJECT (fakeadec, "filter %" GST_PTR_FORMAT " result %"
+      GST_PTR_FORMAT, filter, result);
+
+  GST_OBJECT_LOCK (fakeadec);
+  gst_fakeadec_cache_store (fakeadec->query_caps_cache,
+      &fakeadec->query_caps_cache_next, filter, result);
+  GST_OBJECT_UNLOCK (fakeadec);
+
+  return result;
+}
+
+static gboolean
+gst_fakeadec_sink_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  GstFakeAdec *fakeadec = GST_FAKEADEC (parent);
+  gboolean fast_path;
+
+  GST_OBJECT_LOCK (fakeadec);
+  fast_path = fakeadec->query_fast_path;
+  GST_OBJECT_UNLOCK (fakeadec);
+
+  if (!fast_path || sink_media_types == NULL)
+    return gst_pad_query_default (pad, parent, query);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_ACCEPT_CAPS:{
+      GstCaps *caps;
+
+      gst_query_parse_accept_caps (query, &caps);
+      gst_query_set_accept_caps_result (query,
+          gst_fakeadec_accept_caps (fakeadec, caps));
+      return TRUE;
+    }
+    case GST_QUERY_CAPS:{
+      GstCaps *filter, *result;
+
+      gst_query_parse_caps (query, &filter);
+      if (filter == NULL)
+        result = gst_pad_get_pad_template_caps (pad);
+      else
+        result = gst_fakeadec_query_caps (fakeadec, filter);
+
+      if (result == NULL)
+        break;
+
+      gst_query_set_caps_result (query, result);
+      gst_caps_unref (result);
+      return TRUE;
+    }
+    default:
+      break;
+  }
+
+  return gst_pad_query_default (pad, parent, query);
 }
 
 static GstFlowReturn
@@ -34,14 +34,34 @@ G_BEGIN_DECLS
   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_FAKEADEC))
 #define GST_IS_FAKEADEC_CLASS(klass) \
   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_FAKEADEC))
+
+/* number of filtered CAPS answers kept per element */
+#define GST_FAKEADEC_CAPS_CACHE_SIZE 4
+
 typedef struct _GstFakeAdec GstFakeAdec;
 typedef struct _GstFakeAdecClass GstFakeAdecClass;
+typedef struct _GstFakeAdecCapsCacheEntry GstFakeAdecCapsCacheEntry;
+
+struct _GstFakeAdecCapsCacheEntry
+{
+  GstCaps *caps;
+  GstCaps *result;
+};
 
 struct _GstFakeAdec
 {
   GstElement element;
 
   GstPad *sinkpad, *srcpad;
+
+  gboolean query_fast_path;
+
+  /* recent filtered sink CAPS answers, protected by the object lock.
+   * Keys are copies of the filter caps, compared by content, so callers
+   * keep their caps writable. Up to GST_FAKEADEC_CAPS_CACHE_SIZE keys and
+   * results stay alive until finalize. */
+  GstFakeAdecCapsCacheEntry query_caps_cache[GST_FAKEADEC_CAPS_CACHE_SIZE];
+  guint query_caps_cache_next;
 };
 
 struct _GstFakeAdecClass
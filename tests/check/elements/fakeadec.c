@@ -76,6 +76,61 @@ GST_START_TEST (test_fakeadec_input_output_caps)
 
 GST_END_TEST;
 
+GST_START_TEST (test_fakeadec_sink_queries)
+{
+  GstElement *dec;
+  GstPad *sinkpad;
+  GstCaps *caps, *filter, *result, *expected, *tmp_caps;
+
+  dec = gst_element_factory_make ("fakeadec", NULL);
+  fail_unless (dec != NULL, "failed to create fakeadec element");
+
+  sinkpad = gst_element_get_static_pad (dec, "sink");
+  fail_unless (sinkpad != NULL, "failed to get sinkpad");
+
+  caps = gst_caps_from_string ("audio/mpeg, mpegversion=(int)1, layer=(int)3");
+  fail_unless (gst_pad_query_accept_caps (sinkpad, caps));
+  fail_unless (gst_pad_query_accept_caps (sinkpad, caps));
+  gst_caps_unref (caps);
+
+  caps = gst_caps_from_string ("video/x-raw");
+  fail_if (gst_pad_query_accept_caps (sinkpad, caps));
+  fail_if (gst_pad_query_accept_caps (sinkpad, caps));
+  gst_caps_unref (caps);
+
+  caps = gst_caps_from_string ("audio/x-raw(memory:NotSystemMemory)");
+  fail_if (gst_pad_query_accept_caps (sinkpad, caps));
+  gst_caps_unref (caps);
+
+  tmp_caps = gst_pad_get_pad_template_caps (sinkpad);
+
+  result = gst_pad_query_caps (sinkpad, NULL);
+  fail_unless (gst_caps_is_equal (result, tmp_caps));
+  gst_caps_unref (result);
+
+  filter = gst_caps_from_string ("video/x-raw; "
+      "audio/x-opus, channels=(int)2; audio/mpeg, mpegversion=(int)4");
+  expected = gst_caps_intersect_full (filter, tmp_caps,
+      GST_CAPS_INTERSECT_FIRST);
+  result = gst_pad_query_caps (sinkpad, filter);
+  fail_unless (gst_caps_is_equal (result, expected));
+  gst_caps_unref (result);
+  /* the cache keeps a copy, not a ref on the caller's filter */
+  fail_unless (gst_caps_is_writable (filter));
+  /* the second query of the same filter is answered from the cache */
+  result = gst_pad_query_caps (sinkpad, filter);
+  fail_unless (gst_caps_is_equal (result, expected));
+  gst_caps_unref (result);
+  gst_caps_unref (expected);
+  gst_caps_unref (filter);
+
+  gst_caps_unref (tmp_caps);
+  gst_object_unref (sinkpad);
+  gst_object_unref (dec);
+}
+
+GST_END_TEST;
+
 static GstFlowReturn
 chain_probe (GstPad * pad, GstObject * parent, GstBuffer * buffer)
 {
@@ -154,21 +209,26 @@ decodebin_pad_added_cb (GstElement * dec, GstPad * pad, gpointer user_data)
       GST_DEBUG_GRAPH_SHOW_ALL, "complete");
 }
 
-GST_START_TEST (test_fakeadec_negotiation_pipeline)
+static void
+decodebin_element_added_cb (GstBin * bin, GstElement * element,
+    gpointer user_data)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+
+  if (factory != NULL
+      && g_strcmp0 (GST_OBJECT_NAME (factory), "fakeadec") == 0)
+    g_object_set (element, "query-fast-path", GPOINTER_TO_INT (user_data),
+        NULL);
+}
+
+static GstElement *
+create_negotiation_pipeline (gboolean query_fast_path)
 {
-  GstStateChangeReturn sret;
-  GstPluginFeature *feature;
-  GstMessage *msg;
   GstCaps *caps;
   GstElement *pipe, *src, *filter, *dec;
 
   pipe = gst_pipeline_new (NULL);
 
-  feature = gst_registry_find_feature (gst_registry_get (),
-      "fakeadec", GST_TYPE_ELEMENT_FACTORY);
-
-  gst_plugin_feature_set_rank (feature, GST_RANK_PRIMARY + 100);
-
   src = gst_element_factory_make ("fakesrc", NULL);
   fail_unless (src != NULL);
   g_object_set (G_OBJECT (src), "num-buffers", 5, "sizetype", 2, "filltype", 2,
@@ -185,10 +245,30 @@ GST_START_TEST (test_fakeadec_negotiation_pipeline)
 
   g_signal_connect (dec, "pad-added",
       G_CALLBACK (decodebin_pad_added_cb), pipe);
+  g_signal_connect (dec, "element-added",
+      G_CALLBACK (decodebin_element_added_cb),
+      GINT_TO_POINTER (query_fast_path));
 
   gst_bin_add_many (GST_BIN (pipe), src, filter, dec, NULL);
   gst_element_link_many (src, filter, dec, NULL);
 
+  return pipe;
+}
+
+GST_START_TEST (test_fakeadec_negotiation_pipeline)
+{
+  GstStateChangeReturn sret;
+  GstPluginFeature *feature;
+  GstMessage *msg;
+  GstElement *pipe;
+
+  feature = gst_registry_find_feature (gst_registry_get (),
+      "fakeadec", GST_TYPE_ELEMENT_FACTORY);
+
+  gst_plugin_feature_set_rank (feature, GST_RANK_PRIMARY + 100);
+
+  pipe = create_negotiation_pipeline (TRUE);
+
   sret = gst_element_set_state (pipe, GST_STATE_PLAYING);
   fail_unless_equals_int (sret, GST_STATE_CHANGE_ASYNC);
 
@@ -209,6 +289,105 @@ GST_START_TEST (test_fakeadec_negotiation_pipeline)
 
 GST_END_TEST;
 
+#define NUM_PARALLEL_PIPELINES 16
+#define NUM_PARALLEL_ROUNDS 4
+
+static GstBusSyncReply
+async_done_sync_handler (GstBus * bus, GstMessage * msg, gpointer user_data)
+{
+  gint64 *async_done = user_data;
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ASYNC_DONE && *async_done == 0)
+    *async_done = g_get_monotonic_time ();
+
+  return GST_BUS_PASS;
+}
+
+/* returns the average PLAYING to ASYNC_DONE time per stream in us */
+static gint64
+run_parallel_pipelines (gboolean query_fast_path)
+{
+  GstStateChangeReturn sret;
+  GstMessage *msg;
+  GstElement *pipes[NUM_PARALLEL_PIPELINES];
+  gint64 start[NUM_PARALLEL_PIPELINES];
+  gint64 async_done[NUM_PARALLEL_PIPELINES];
+  gint64 total = 0;
+  gint i;
+
+  for (i = 0; i < NUM_PARALLEL_PIPELINES; i++) {
+    pipes[i] = create_negotiation_pipeline (query_fast_path);
+    async_done[i] = 0;
+    gst_bus_set_sync_handler (GST_ELEMENT_BUS (pipes[i]),
+        async_done_sync_handler, &async_done[i], NULL);
+  }
+
+  /* autoplug all the streams at once */
+  for (i = 0; i < NUM_PARALLEL_PIPELINES; i++) {
+    start[i] = g_get_monotonic_time ();
+    sret = gst_element_set_state (pipes[i], GST_STATE_PLAYING);
+    fail_unless_equals_int (sret, GST_STATE_CHANGE_ASYNC);
+  }
+
+  for (i = 0; i < NUM_PARALLEL_PIPELINES; i++) {
+    msg = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (pipes[i]),
+        GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    fail_unless (msg != NULL);
+    fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+    gst_message_unref (msg);
+
+    fail_unless (async_done[i] != 0);
+    GST_INFO ("fast path %d, pipeline %d: autoplug setup took %"
+        G_GINT64_FORMAT " us", query_fast_path, i, async_done[i] - start[i]);
+    total += async_done[i] - start[i];
+  }
+
+  for (i = 0; i < NUM_PARALLEL_PIPELINES; i++) {
+    gst_element_set_state (pipes[i], GST_STATE_NULL);
+    gst_object_unref (pipes[i]);
+  }
+
+  return total / NUM_PARALLEL_PIPELINES;
+}
+
+GST_START_TEST (test_fakeadec_negotiation_pipeline_parallel)
+{
+  GstPluginFeature *feature;
+  gint64 default_total = 0, fast_path_total = 0;
+  gint i;
+
+  feature = gst_registry_find_feature (gst_registry_get (),
+      "fakeadec", GST_TYPE_ELEMENT_FACTORY);
+
+  gst_plugin_feature_set_rank (feature, GST_RANK_PRIMARY + 100);
+
+  /* warm-up, so neither measured mode pays for plugin loading */
+  run_parallel_pipelines (TRUE);
+
+  /* alternate which mode goes first to cancel out run order effects */
+  for (i = 0; i < NUM_PARALLEL_ROUNDS; i++) {
+    if (i % 2 == 0) {
+      default_total += run_parallel_pipelines (FALSE);
+      fast_path_total += run_parallel_pipelines (TRUE);
+    } else {
+      fast_path_total += run_parallel_pipelines (TRUE);
+      default_total += run_parallel_pipelines (FALSE);
+    }
+  }
+
+  GST_INFO ("%d pipelines, %d rounds: average autoplug setup %"
+      G_GINT64_FORMAT " us per stream with the default query handler, %"
+      G_GINT64_FORMAT " us with the query fast path", NUM_PARALLEL_PIPELINES,
+      NUM_PARALLEL_ROUNDS, default_total / NUM_PARALLEL_ROUNDS,
+      fast_path_total / NUM_PARALLEL_ROUNDS);
+
+  /* don't want to interfere with any other of the other tests */
+  gst_plugin_feature_set_rank (feature, GST_RANK_NONE);
+  gst_object_unref (feature);
+}
+
+GST_END_TEST;
+
 static Suite *
 fakeadec_suite (void)
 {
@@ -218,8 +397,10 @@ fakeadec_suite (void)
   tc_chain = tcase_create ("fakeadec simple");
   tcase_add_test (tc_chain, test_fakeadec_create);
   tcase_add_test (tc_chain, test_fakeadec_input_output_caps);
+  tcase_add_test (tc_chain, test_fakeadec_sink_queries);
   tcase_add_test (tc_chain, test_fakeadec_buffer);
   tcase_add_test (tc_chain, test_fakeadec_negotiation_pipeline);
+  tcase_add_test (tc_chain, test_fakeadec_negotiation_pipeline_parallel);
   suite_add_tcase (s, tc_chain);
 
   return s;
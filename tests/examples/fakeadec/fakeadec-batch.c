@@ -0,0 +1,436 @@
+/* batch application for decoding files through fakeadec with playbin
+ *
+ * Copyright 2026 GstTutorial contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gprintf.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#define DEFAULT_JOBS 4
+
+/* from GstPlayFlags, which is not in the public headers */
+#define GST_PLAY_FLAG_VIDEO (1 << 0)
+#define GST_PLAY_FLAG_TEXT  (1 << 2)
+
+/* per-file result, the process exits with the highest one seen. 1 is left
+ * for usage errors */
+typedef enum
+{
+  BATCH_OK = 0,                 /* reached EOS */
+  BATCH_ERROR_URI = 2,          /* could not be turned into a URI */
+  BATCH_ERROR_STATE = 3,        /* pipeline refused to go to PLAYING */
+  BATCH_ERROR_STREAM = 4,       /* error message while decoding */
+  BATCH_ERROR_TIMEOUT = 5       /* no EOS or error within --timeout */
+} BatchResult;
+
+typedef struct _BatchWorker BatchWorker;
+
+/* Global structure */
+
+typedef struct _BatchData
+{
+  GMainLoop *mainloop;
+
+  gchar **files;
+  guint n_files;
+  guint next_file;
+
+  BatchWorker *workers;
+  guint n_workers;
+  guint running;
+  guint timeout;
+
+  guint n_ok;
+  guint n_failed;
+  guint64 total_bytes;
+  BatchResult worst;
+} BatchData;
+
+/* one reusable playbin, moved back to READY between files */
+struct _BatchWorker
+{
+  BatchData *batch;
+  GstElement *pipeline;
+  guint watch_id;
+  guint timeout_id;
+
+  guint file_idx;
+  guint64 bytes;
+  gint64 start;
+};
+
+static gchar *
+cmdline_to_uri (const gchar * arg)
+{
+  if (gst_uri_is_valid (arg))
+    return g_strdup (arg);
+
+  return gst_filename_to_uri (arg, NULL);
+}
+
+/* input size for throughput, only known for local files */
+static guint64
+_uri_size (const gchar * uri)
+{
+  GStatBuf st;
+  gchar *filename;
+  guint64 size = 0;
+
+  filename = g_filename_from_uri (uri, NULL, NULL);
+  if (filename != NULL && g_stat (filename, &st) == 0)
+    size = st.st_size;
+  g_free (filename);
+
+  return size;
+}
+
+static gdouble
+_mb_per_sec (guint64 bytes, gint64 usecs)
+{
+  if (usecs <= 0)
+    return 0.0;
+
+  /* bytes per microsecond is MB per second */
+  return (gdouble) bytes / usecs;
+}
+
+static void
+_report_file (BatchWorker * worker, BatchResult result)
+{
+  BatchData *batch = worker->batch;
+  const gchar *file = batch->files[worker->file_idx];
+
+  if (result == BATCH_OK) {
+    gint64 elapsed = g_get_monotonic_time () - worker->start;
+
+    g_printf ("[%d] %s: %.2f MB in %.3f s, %.2f MB/s\n", result, file,
+        worker->bytes / 1000000.0, elapsed / 1000000.0,
+        _mb_per_sec (worker->bytes, elapsed));
+    batch->n_ok++;
+    batch->total_bytes += worker->bytes;
+  } else {
+    g_printf ("[%d] %s: failed\n", result, file);
+    batch->n_failed++;
+  }
+
+  if (result > batch->worst)
+    batch->worst = result;
+}
+
+static gboolean _on_worker_timeout (BatchWorker * worker);
+
+/* Start the next pending file on @worker. Returns FALSE when there is
+ * nothing left to do. */
+static gboolean
+_worker_start_next (BatchWorker * worker)
+{
+  BatchData *batch = worker->batch;
+
+  while (batch->next_file < batch->n_files) {
+    gchar *uri;
+
+    worker->file_idx = batch->next_file++;
+
+    uri = cmdline_to_uri (batch->files[worker->file_idx]);
+    if (uri == NULL) {
+      _report_file (worker, BATCH_ERROR_URI);
+      continue;
+    }
+
+    worker->bytes = _uri_size (uri);
+    g_object_set (worker->pipeline, "uri", uri, NULL);
+    g_free (uri);
+
+    worker->start = g_get_monotonic_time ();
+    if (gst_element_set_state (worker->pipeline,
+            GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE) {
+      if (batch->timeout > 0)
+        worker->timeout_id = g_timeout_add_seconds (batch->timeout,
+            (GSourceFunc) _on_worker_timeout, worker);
+      return TRUE;
+    }
+
+    _report_file (worker, BATCH_ERROR_STATE);
+    gst_element_set_state (worker->pipeline, GST_STATE_NULL);
+    /* drop the error message posted for the failed file */
+    gst_bus_set_flushing (GST_ELEMENT_BUS (worker->pipeline), TRUE);
+    gst_bus_set_flushing (GST_ELEMENT_BUS (worker->pipeline), FALSE);
+  }
+
+  return FALSE;
+}
+
+static void
+_worker_finish (BatchWorker * worker, BatchResult result)
+{
+  BatchData *batch = worker->batch;
+
+  if (worker->timeout_id != 0) {
+    g_source_remove (worker->timeout_id);
+    worker->timeout_id = 0;
+  }
+
+  _report_file (worker, result);
+
+  /* READY keeps the elements around for the next file, after an error go
+   * all the way down so nothing broken is reused */
+  gst_element_set_state (worker->pipeline,
+      result == BATCH_OK ? GST_STATE_READY : GST_STATE_NULL);
+  gst_bus_set_flushing (GST_ELEMENT_BUS (worker->pipeline), TRUE);
+  gst_bus_set_flushing (GST_ELEMENT_BUS (worker->pipeline), FALSE);
+
+  if (!_worker_start_next (worker) && --batch->running == 0)
+    g_main_loop_quit (batch->mainloop);
+}
+
+static gboolean
+_on_worker_timeout (BatchWorker * worker)
+{
+  /* the source is removed by returning FALSE */
+  worker->timeout_id = 0;
+
+  g_printerr ("ERROR: %s: timed out after %u s\n",
+      worker->batch->files[worker->file_idx], worker->batch->timeout);
+  _worker_finish (worker, BATCH_ERROR_TIMEOUT);
+
+  return FALSE;
+}
+
+static gboolean
+_on_bus_message (GstBus * bus, GstMessage * message, BatchWorker * worker)
+{
+  switch (GST_MESSAGE_TYPE (message)) {
+    case GST_MESSAGE_ERROR:{
+      GError *err = NULL;
+      gchar *name = gst_object_get_path_string (GST_MESSAGE_SRC (message));
+      gst_message_parse_error (message, &err, NULL);
+
+      g_printerr ("ERROR: %s: from element %s: %s\n",
+          worker->batch->files[worker->file_idx], name, err->message);
+      g_error_free (err);
+      g_free (name);
+
+      _worker_finish (worker, BATCH_ERROR_STREAM);
+      break;
+    }
+    case GST_MESSAGE_EOS:
+      _worker_finish (worker, BATCH_OK);
+      break;
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+_worker_init (BatchWorker * worker, BatchData * batch)
+{
+  GstElement *sink;
+  GstBus *bus;
+  guint flags;
+
+  worker->batch = batch;
+  worker->pipeline = gst_element_factory_make ("playbin", NULL);
+  if (worker->pipeline == NULL) {
+    g_printerr ("Failed to create playbin element. Aborting");
+    return FALSE;
+  }
+
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (sink, "sync", FALSE, NULL);
+  g_object_set (worker->pipeline, "audio-sink", sink, NULL);
+
+  /* audio only, so the measured time is spent on the fakeadec path and
+   * not in video or subtitle decoders */
+  g_object_get (worker->pipeline, "flags", &flags, NULL);
+  flags &= ~(GST_PLAY_FLAG_VIDEO | GST_PLAY_FLAG_TEXT);
+  g_object_set (worker->pipeline, "flags", flags, NULL);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (worker->pipeline));
+  worker->watch_id = gst_bus_add_watch (bus, (GstBusFunc) _on_bus_message,
+      worker);
+  gst_object_unref (bus);
+
+  return TRUE;
+}
+
+static void
+_worker_clear (BatchWorker * worker)
+{
+  if (worker->pipeline == NULL)
+    return;
+
+  g_source_remove (worker->watch_id);
+  if (worker->timeout_id != 0)
+    g_source_remove (worker->timeout_id);
+  gst_element_set_state (worker->pipeline, GST_STATE_NULL);
+  gst_object_unref (worker->pipeline);
+  worker->pipeline = NULL;
+}
+
+static GPtrArray *
+_collect_files (const gchar * list_file, gint argc, gchar ** argv)
+{
+  GPtrArray *files = g_ptr_array_new_with_free_func (g_free);
+  gint i;
+
+  if (list_file != NULL) {
+    GError *err = NULL;
+    gchar *contents;
+    gchar **lines;
+
+    if (!g_file_get_contents (list_file, &contents, NULL, &err)) {
+      g_printerr ("Failed to read %s: %s\n", list_file, err->message);
+      g_error_free (err);
+      g_ptr_array_free (files, TRUE);
+      return NULL;
+    }
+
+    lines = g_strsplit (contents, "\n", -1);
+    for (i = 0; lines[i] != NULL; i++) {
+      g_strstrip (lines[i]);
+      if (lines[i][0] != '\0' && lines[i][0] != '#')
+        g_ptr_array_add (files, g_strdup (lines[i]));
+    }
+    g_strfreev (lines);
+    g_free (contents);
+  }
+
+  for (i = 1; i < argc; i++)
+    g_ptr_array_add (files, g_strdup (argv[i]));
+
+  return files;
+}
+
+int
+main (int argc, gchar ** argv)
+{
+  BatchData *batch;
+  GPtrArray *files;
+  GstPluginFeature *feature;
+  GOptionContext *ctx;
+  GError *err = NULL;
+  gchar *list_file = NULL;
+  gint jobs = DEFAULT_JOBS;
+  gint timeout = 0;
+  gint64 start, elapsed;
+  guint i;
+  gint ret;
+  GOptionEntry options[] = {
+    {"file-list", 'f', 0, G_OPTION_ARG_FILENAME, &list_file,
+        "File with one file name or URI per line", "FILE"},
+    {"jobs", 'j', 0, G_OPTION_ARG_INT, &jobs,
+        "Number of pipelines running at once (default 4)", "K"},
+    {"timeout", 't', 0, G_OPTION_ARG_INT, &timeout,
+        "Give up on a file after SECONDS (default 0, no timeout)", "SECONDS"},
+    {NULL}
+  };
+
+  ctx = g_option_context_new ("[FILE|URI...]");
+  g_option_context_add_main_entries (ctx, options, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Error initializing: %s\n", err->message);
+    g_error_free (err);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  files = _collect_files (list_file, argc, argv);
+  g_free (list_file);
+  if (files == NULL)
+    return 1;
+
+  if (files->len == 0 || jobs < 1 || timeout < 0) {
+    g_print ("Usage: %s [-j K] [-t SECONDS] [-f FILE] [FILE|URI...]\n",
+        argv[0]);
+    g_ptr_array_free (files, TRUE);
+    return 1;
+  }
+
+  feature = gst_registry_find_feature (gst_registry_get (), "fakeadec",
+      GST_TYPE_ELEMENT_FACTORY);
+  if (feature == NULL) {
+    g_printerr ("Failed to find fakeadec element. Aborting");
+    g_ptr_array_free (files, TRUE);
+    return 1;
+  }
+  gst_plugin_feature_set_rank (feature, GST_RANK_PRIMARY + 100);
+
+  batch = g_new0 (BatchData, 1);
+  batch->mainloop = g_main_loop_new (NULL, FALSE);
+  batch->files = (gchar **) files->pdata;
+  batch->n_files = files->len;
+  batch->timeout = timeout;
+  batch->n_workers = MIN ((guint) jobs, files->len);
+  batch->workers = g_new0 (BatchWorker, batch->n_workers);
+
+  ret = 0;
+  for (i = 0; i < batch->n_workers; i++) {
+    if (!_worker_init (&batch->workers[i], batch)) {
+      ret = 1;
+      break;
+    }
+  }
+
+  start = g_get_monotonic_time ();
+  if (ret == 0) {
+    for (i = 0; i < batch->n_workers; i++) {
+      if (_worker_start_next (&batch->workers[i]))
+        batch->running++;
+    }
+
+    if (batch->running > 0)
+      g_main_loop_run (batch->mainloop);
+
+    ret = batch->worst;
+  }
+  elapsed = g_get_monotonic_time () - start;
+
+  if (ret != 1) {
+    g_printf ("\n%u files (%u ok, %u failed) with %u pipelines in %.3f s\n",
+        batch->n_files, batch->n_ok, batch->n_failed, batch->n_workers,
+        elapsed / 1000000.0);
+    g_printf ("%.2f MB, %.2f MB/s, %.2f streams/s\n",
+        batch->total_bytes / 1000000.0,
+        _mb_per_sec (batch->total_bytes, elapsed),
+        elapsed > 0 ? batch->n_ok * 1000000.0 / elapsed : 0.0);
+  }
+
+  for (i = 0; i < batch->n_workers; i++)
+    _worker_clear (&batch->workers[i]);
+  g_free (batch->workers);
+  g_main_loop_unref (batch->mainloop);
+  g_free (batch);
+  g_ptr_array_free (files, TRUE);
+
+  /* don't want to interfere with any other of the other tests */
+  gst_plugin_feature_set_rank (feature, GST_RANK_NONE);
+  gst_object_unref (feature);
+
+  return ret;
+}
@@ -28,19 +28,118 @@
 #include <glib/gprintf.h>
 #include <gst/gst.h>
 
+#define DEFAULT_LATENCY_RUNS 20
+
+/* from GstPlayFlags, which is not in the public headers */
+#define GST_PLAY_FLAG_VIDEO (1 << 0)
+#define GST_PLAY_FLAG_TEXT  (1 << 2)
+
+/* Startup milestones recorded in latency mode, relative to the moment the
+ * pipeline is asked to go to PLAYING */
+typedef enum
+{
+  MILESTONE_AUTOPLUG,
+  MILESTONE_DEC_FIRST_BUFFER,
+  MILESTONE_SINK_FIRST_BUFFER,
+  MILESTONE_ASYNC_DONE,
+  MILESTONE_LAST
+} Milestone;
+
+static const gchar *milestone_names[MILESTONE_LAST] = {
+  "autoplug fakeadec",
+  "fakeadec first buffer",
+  "sink first buffer",
+  "async-done",
+};
+
 /* Global structure */
 
 typedef struct _MyDataStruct
 {
   GMainLoop *mainloop;
   GstElement *pipeline;
+
+  gboolean latency;
+  gboolean failed;
+
+  /* monotonic timestamps in microseconds, 0 when not reached yet. With
+   * several audio tracks there is one fakeadec per track, so milestones can
+   * be hit from several streaming threads at once and the first write is
+   * taken under the lock. They are only read from the main loop after the
+   * pipeline is back to NULL */
+  GMutex lock;
+  gint64 start;
+  gint64 milestones[MILESTONE_LAST];
 } MyDataStruct;
 
+static void
+_mark_milestone (MyDataStruct * data, Milestone milestone)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  g_mutex_lock (&data->lock);
+  if (data->milestones[milestone] == 0)
+    data->milestones[milestone] = now;
+  g_mutex_unlock (&data->lock);
+}
+
+static GstPadProbeReturn
+_on_dec_first_buffer (GstPad * pad, GstPadProbeInfo * info,
+    MyDataStruct * data)
+{
+  /* fires right before the buffer enters gst_fakeadec_chain */
+  _mark_milestone (data, MILESTONE_DEC_FIRST_BUFFER);
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static GstPadProbeReturn
+_on_sink_first_buffer (GstPad * pad, GstPadProbeInfo * info,
+    MyDataStruct * data)
+{
+  _mark_milestone (data, MILESTONE_SINK_FIRST_BUFFER);
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static void
+_on_element_setup (GstElement * playbin, GstElement * element,
+    MyDataStruct * data)
+{
+  GstElementFactory *factory;
+  GstPad *pad;
+
+  factory = gst_element_get_factory (element);
+  if (factory == NULL
+      || g_strcmp0 (GST_OBJECT_NAME (factory), "fakeadec") != 0)
+    return;
+
+  _mark_milestone (data, MILESTONE_AUTOPLUG);
+
+  pad = gst_element_get_static_pad (element, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) _on_dec_first_buffer, data, NULL);
+  gst_object_unref (pad);
+}
+
 static GstBusSyncReply
+_on_bus_sync_message (GstBus * bus, GstMessage * message, MyDataStruct * data)
+{
+  /* only take the timestamp here, anything slower is done from the main
+   * loop so the posting streaming thread is not held up */
+  if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_ASYNC_DONE)
+    _mark_milestone (data, MILESTONE_ASYNC_DONE);
+
+  return GST_BUS_PASS;
+}
+
+static gboolean
 _on_bus_message (GstBus * bus, GstMessage * message, MyDataStruct * data)
 {
   switch (GST_MESSAGE_TYPE (message)) {
     case GST_MESSAGE_ASYNC_DONE:
+      if (data->latency) {
+        g_main_loop_quit (data->mainloop);
+        break;
+      }
       // export GST_DEBUG_DUMP_DOT_DIR=/home/hoonheelee/work/dot_graph
       GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (data->pipeline),
           GST_DEBUG_GRAPH_SHOW_ALL, "async-done");
@@ -55,6 +154,7 @@ _on_bus_message (GstBus * bus, GstMessage * message, MyDataStruct * data)
       g_free (name);
 
       g_printf ("Stopping\n");
+      data->failed = TRUE;
       g_main_loop_quit (data->mainloop);
       break;
     }
@@ -66,7 +166,7 @@ _on_bus_message (GstBus * bus, GstMessage * message, MyDataStruct * data)
       break;
   }
 
-  return GST_BUS_PASS;
+  return TRUE;
 }
 
 static gchar *
@@ -78,63 +178,220 @@ cmdline_to_uri (const gchar * arg)
   return gst_filename_to_uri (arg, NULL);
 }
 
+static gboolean
+_run_once (MyDataStruct * data, const gchar * uri)
+{
+  GstBus *bus;
+  GstElement *sink;
+  guint watch_id;
+  gint i;
+
+  data->pipeline = gst_element_factory_make ("playbin", NULL);
+  if (data->pipeline == NULL) {
+    g_printerr ("Failed to create playbin element. Aborting");
+    return FALSE;
+  }
+
+  g_object_set (data->pipeline, "uri", uri, NULL);
+
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (sink, "sync", FALSE, NULL);
+  g_object_set (data->pipeline, "audio-sink", sink, NULL);
+
+  data->failed = FALSE;
+  for (i = 0; i < MILESTONE_LAST; i++)
+    data->milestones[i] = 0;
+
+  if (data->latency) {
+    GstPad *pad;
+    guint flags;
+
+    /* audio only, so no video preroll is part of the async-done time */
+    g_object_get (data->pipeline, "flags", &flags, NULL);
+    flags &= ~(GST_PLAY_FLAG_VIDEO | GST_PLAY_FLAG_TEXT);
+    g_object_set (data->pipeline, "flags", flags, NULL);
+
+    pad = gst_element_get_static_pad (sink, "sink");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) _on_sink_first_buffer, data, NULL);
+    gst_object_unref (pad);
+
+    g_signal_connect (data->pipeline, "element-setup",
+        G_CALLBACK (_on_element_setup), data);
+  }
+
+  /* Put a bus handler */
+  bus = gst_pipeline_get_bus (GST_PIPELINE (data->pipeline));
+  gst_bus_set_sync_handler (bus, (GstBusSyncHandler) _on_bus_sync_message,
+      data, NULL);
+  watch_id = gst_bus_add_watch (bus, (GstBusFunc) _on_bus_message, data);
+
+  /* Start pipeline */
+  data->start = g_get_monotonic_time ();
+  gst_element_set_state (data->pipeline, GST_STATE_PLAYING);
+  g_main_loop_run (data->mainloop);
+
+  gst_element_set_state (data->pipeline, GST_STATE_NULL);
+
+  g_source_remove (watch_id);
+  gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
+  gst_object_unref (bus);
+
+  gst_object_unref (data->pipeline);
+  data->pipeline = NULL;
+
+  return !data->failed;
+}
+
+static gint
+_compare_double (gconstpointer a, gconstpointer b)
+{
+  gdouble da = *(const gdouble *) a;
+  gdouble db = *(const gdouble *) b;
+
+  return (da > db) - (da < db);
+}
+
+/* nearest-rank percentile of sorted samples */
+static gdouble
+_percentile (GArray * samples, guint pct)
+{
+  guint rank = (pct * samples->len + 99) / 100;
+
+  if (rank == 0)
+    rank = 1;
+
+  return g_array_index (samples, gdouble, rank - 1);
+}
+
+static void
+_print_latency_report (GArray ** samples, gint runs)
+{
+  gint i;
+
+  g_printf ("\n%-24s %7s %9s %9s %9s %9s %9s\n", "milestone (ms)", "count",
+      "min", "p50", "p90", "p99", "max");
+
+  for (i = 0; i < MILESTONE_LAST; i++) {
+    GArray *s = samples[i];
+
+    if (s->len == 0) {
+      g_printf ("%-24s %3u/%-3d %9s\n", milestone_names[i], s->len, runs,
+          "n/a");
+      continue;
+    }
+
+    g_array_sort (s, _compare_double);
+    g_printf ("%-24s %3u/%-3d %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+        milestone_names[i], s->len, runs, g_array_index (s, gdouble, 0),
+        _percentile (s, 50), _percentile (s, 90), _percentile (s, 99),
+        g_array_index (s, gdouble, s->len - 1));
+  }
+}
+
 int
 main (int argc, gchar ** argv)
 {
-  GstBus *bus;
   MyDataStruct *data;
   gchar *uri;
   GstPluginFeature *feature;
+  GOptionContext *ctx;
+  GError *err = NULL;
+  gboolean latency = FALSE;
+  gint runs = DEFAULT_LATENCY_RUNS;
+  gint64 init_start, init_end;
+  gint ret = 0;
+  GOptionEntry options[] = {
+    {"latency", 'l', 0, G_OPTION_ARG_NONE, &latency,
+        "Measure preroll and first-buffer latency instead of playing", NULL},
+    {"runs", 'n', 0, G_OPTION_ARG_INT, &runs,
+        "Number of runs in latency mode (default 20)", "N"},
+    {NULL}
+  };
 
+  /* gst options are left in argv for gst_init() so it can be timed alone */
+  ctx = g_option_context_new ("URI");
+  g_option_context_add_main_entries (ctx, options, NULL);
+  g_option_context_set_ignore_unknown_options (ctx, TRUE);
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Error initializing: %s\n", err->message);
+    g_error_free (err);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  init_start = g_get_monotonic_time ();
   gst_init (&argc, &argv);
+  init_end = g_get_monotonic_time ();
+
+  if (argc < 2 || runs < 1) {
+    g_print ("Usage: %s [--latency [--runs N]] URI\n", argv[0]);
+    return 1;
+  }
+
+  uri = cmdline_to_uri (argv[1]);
+  if (uri == NULL) {
+    g_print ("Usage: %s [--latency [--runs N]] URI\n", argv[0]);
+    return 1;
+  }
 
   feature = gst_registry_find_feature (gst_registry_get (), "fakeadec",
       GST_TYPE_ELEMENT_FACTORY);
+  if (feature == NULL) {
+    g_printerr ("Failed to find fakeadec element. Aborting");
+    g_free (uri);
+    return 1;
+  }
   gst_plugin_feature_set_rank (feature, GST_RANK_PRIMARY + 100);
 
   data = g_new0 (MyDataStruct, 1);
+  data->latency = latency;
+  g_mutex_init (&data->lock);
+  data->mainloop = g_main_loop_new (NULL, FALSE);
 
-  uri = cmdline_to_uri (argv[1]);
+  if (latency) {
+    GArray *samples[MILESTONE_LAST];
+    gint i, run;
 
-  if (argc < 2 || uri == NULL) {
-    g_print ("Usage: %s URI\n", argv[0]);
-    return 1;
-  }
+    g_printf ("gst_init: %.3f ms\n", (init_end - init_start) / 1000.0);
 
-  data->pipeline = gst_element_factory_make ("playbin", NULL);
-  if (data->pipeline == NULL) {
-    g_printerr ("Failed to create playbin element. Aborting");
-    return 1;
-  }
+    for (i = 0; i < MILESTONE_LAST; i++)
+      samples[i] = g_array_sized_new (FALSE, FALSE, sizeof (gdouble), runs);
 
-  g_object_set (data->pipeline, "uri", uri, NULL);
-  g_free (uri);
+    for (run = 0; run < runs; run++) {
+      if (!_run_once (data, uri)) {
+        ret = 1;
+        break;
+      }
 
-  {
-    GstElement *sink = gst_element_factory_make ("fakesink", NULL);
-    g_object_set (sink, "sync", FALSE, NULL);
-    g_object_set (data->pipeline, "audio-sink", sink, NULL);
-  }
+      for (i = 0; i < MILESTONE_LAST; i++) {
+        gdouble ms;
 
-  data->mainloop = g_main_loop_new (NULL, FALSE);
+        if (data->milestones[i] == 0)
+          continue;
 
-  /* Put a bus handler */
-  bus = gst_pipeline_get_bus (GST_PIPELINE (data->pipeline));
-  gst_bus_set_sync_handler (bus, (GstBusSyncHandler) _on_bus_message, data,
-      NULL);
+        ms = (data->milestones[i] - data->start) / 1000.0;
+        g_array_append_val (samples[i], ms);
+      }
+    }
 
-  /* Start pipeline */
-  gst_element_set_state (data->pipeline, GST_STATE_PLAYING);
-  g_main_loop_run (data->mainloop);
+    _print_latency_report (samples, runs);
 
-  gst_element_set_state (data->pipeline, GST_STATE_NULL);
+    for (i = 0; i < MILESTONE_LAST; i++)
+      g_array_free (samples[i], TRUE);
+  } else if (!_run_once (data, uri)) {
+    ret = 1;
+  }
 
-  gst_object_unref (data->pipeline);
-  gst_object_unref (bus);
+  g_main_loop_unref (data->mainloop);
+  g_mutex_clear (&data->lock);
+  g_free (data);
+  g_free (uri);
 
   /* don't want to interfere with any other of the other tests */
   gst_plugin_feature_set_rank (feature, GST_RANK_NONE);
   gst_object_unref (feature);
 
-  return 0;
+  return ret;
 }